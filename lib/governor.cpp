@@ -0,0 +1,239 @@
+/*
+  This file is part of Allie Chess.
+  Copyright (C) 2018, 2019 Adam Treat
+
+  Allie Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Allie Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Allie Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+*/
+
+#include "governor.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+#include <QtMath>
+
+//#define DEBUG_GOVERNOR
+
+// How often we go back to the cgroup files for fresh numbers
+#define UPDATE_INTERVAL_MS 1000
+// Fraction of the memory limit we allow ourselves to use
+#define MEMORY_PRESSURE 0.9
+
+// cgroup v1 reports "no limit" as a huge page aligned number rather than a keyword
+static const quint64 s_unlimitedMemory = quint64(1) << 62;
+
+class MyGovernor : public Governor { };
+Q_GLOBAL_STATIC(MyGovernor, GovernorInstance)
+Governor* Governor::globalInstance()
+{
+    return GovernorInstance();
+}
+
+static QString readFirstLine(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+    return QString::fromLatin1(file.readLine()).trimmed();
+}
+
+static quint64 readStat(const QString &path, const char *key)
+{
+    // memory.stat has one "key value" pair per line
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    while (!file.atEnd()) {
+        const QList<QByteArray> parts = file.readLine().trimmed().split(' ');
+        if (parts.count() == 2 && parts.at(0) == key)
+            return parts.at(1).toULongLong();
+    }
+    return 0;
+}
+
+static QString cgroupDirectory(const QString &mount, const QString &path)
+{
+    // Inside a container with its own cgroup namespace the path is just "/", but
+    // without one we have to descend to our own cgroup
+    const QString directory = mount + path;
+    if (QDir(directory).exists())
+        return directory;
+    return mount;
+}
+
+Governor::Governor()
+    : m_cpuQuota(-1.0f),
+    m_memoryLimit(0),
+    m_memoryUsage(0),
+    m_excessMark(0)
+{
+    findCgroupPaths();
+    update(true /*force*/);
+}
+
+Governor::~Governor()
+{
+}
+
+void Governor::setRootPath(const QString &path)
+{
+    m_rootPath = path;
+    m_unifiedPath.clear();
+    m_cpuPath.clear();
+    m_memoryPath.clear();
+    findCgroupPaths();
+    m_excessMark = 0;
+    update(true /*force*/);
+}
+
+void Governor::findCgroupPaths()
+{
+    // Each line of /proc/self/cgroup is hierarchy-ID:controller-list:cgroup-path where the
+    // unified v2 hierarchy has an empty controller list
+    QFile file(m_rootPath + QLatin1String("/proc/self/cgroup"));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return;
+
+    const QString mount = m_rootPath + QLatin1String("/sys/fs/cgroup");
+
+    // In the hybrid layout the v1 controllers sit next to the unified hierarchy
+    const QString unifiedMount = QDir(mount + QLatin1String("/unified")).exists()
+        ? mount + QLatin1String("/unified") : mount;
+
+    while (!file.atEnd()) {
+        const QString line = QString::fromLatin1(file.readLine()).trimmed();
+        const QStringList parts = line.split(':');
+        if (parts.count() < 3)
+            continue;
+
+        const QString controllers = parts.at(1);
+        const QString path = parts.mid(2).join(':');
+        if (controllers.isEmpty()) {
+            m_unifiedPath = cgroupDirectory(unifiedMount, path);
+        } else if (controllers.split(',').contains(QLatin1String("cpu"))) {
+            m_cpuPath = cgroupDirectory(mount + '/' + controllers, path);
+        } else if (controllers.split(',').contains(QLatin1String("memory"))) {
+            m_memoryPath = cgroupDirectory(mount + QLatin1String("/memory"), path);
+        }
+    }
+
+#if defined(DEBUG_GOVERNOR)
+    qDebug() << "cgroup unified:" << m_unifiedPath << "cpu:" << m_cpuPath << "memory:" << m_memoryPath;
+#endif
+}
+
+void Governor::readCpuLimit()
+{
+    m_cpuQuota = -1.0f;
+
+    // v1 is cpu.cfs_quota_us and cpu.cfs_period_us where a quota of -1 is unlimited
+    if (!m_cpuPath.isEmpty()) {
+        bool quotaOk = false;
+        bool periodOk = false;
+        const qint64 quota = readFirstLine(m_cpuPath + QLatin1String("/cpu.cfs_quota_us")).toLongLong(&quotaOk);
+        const qint64 period = readFirstLine(m_cpuPath + QLatin1String("/cpu.cfs_period_us")).toLongLong(&periodOk);
+        if (quotaOk && periodOk && quota > 0 && period > 0)
+            m_cpuQuota = float(quota) / float(period);
+        return;
+    }
+
+    // v2 is cpu.max as "quota period" or "max period"
+    if (!m_unifiedPath.isEmpty()) {
+        const QStringList cpuMax = readFirstLine(m_unifiedPath + QLatin1String("/cpu.max")).split(' ');
+        if (cpuMax.count() != 2)
+            return;
+
+        bool quotaOk = false;
+        bool periodOk = false;
+        const qint64 quota = cpuMax.at(0).toLongLong(&quotaOk);
+        const qint64 period = cpuMax.at(1).toLongLong(&periodOk);
+        if (quotaOk && periodOk && quota > 0 && period > 0)
+            m_cpuQuota = float(quota) / float(period);
+    }
+}
+
+void Governor::readMemory()
+{
+    // The usage includes page cache from the tablebases and the network file which the kernel
+    // will happily reclaim, so take out the inactive file pages to get the working set
+    QString limit;
+    quint64 usage = 0;
+    quint64 inactiveFile = 0;
+    if (!m_memoryPath.isEmpty()) {
+        limit = readFirstLine(m_memoryPath + QLatin1String("/memory.limit_in_bytes"));
+        usage = readFirstLine(m_memoryPath + QLatin1String("/memory.usage_in_bytes")).toULongLong();
+        inactiveFile = readStat(m_memoryPath + QLatin1String("/memory.stat"), "total_inactive_file");
+    } else if (!m_unifiedPath.isEmpty()) {
+        limit = readFirstLine(m_unifiedPath + QLatin1String("/memory.max"));
+        usage = readFirstLine(m_unifiedPath + QLatin1String("/memory.current")).toULongLong();
+        inactiveFile = readStat(m_unifiedPath + QLatin1String("/memory.stat"), "inactive_file");
+    }
+
+    bool ok = false;
+    const quint64 l = limit.toULongLong(&ok); // "max" fails to parse and means unlimited
+    m_memoryLimit = ok && l < s_unlimitedMemory ? l : 0;
+    m_memoryUsage = usage > inactiveFile ? usage - inactiveFile : 0;
+}
+
+bool Governor::update(bool force)
+{
+    if (!force && m_lastUpdate.isValid() && !m_lastUpdate.hasExpired(UPDATE_INTERVAL_MS))
+        return false;
+
+    m_lastUpdate.start();
+    readCpuLimit();
+    readMemory();
+
+#if defined(DEBUG_GOVERNOR)
+    qDebug() << "cpu quota:" << m_cpuQuota
+             << "memory limit:" << m_memoryLimit
+             << "memory usage:" << m_memoryUsage;
+#endif
+    return true;
+}
+
+int Governor::cpuCount() const
+{
+    const int cores = qMax(1, QThread::idealThreadCount());
+    if (m_cpuQuota <= 0.0f)
+        return cores;
+    return qBound(1, qCeil(qreal(m_cpuQuota)), cores);
+}
+
+quint64 Governor::memoryTarget() const
+{
+    return quint64(m_memoryLimit * MEMORY_PRESSURE);
+}
+
+quint64 Governor::takeExcess()
+{
+    if (!hasMemoryLimit())
+        return 0;
+
+    // Memory we give back stays with the allocator to be reused rather than going back to the
+    // kernel, so the working set won't come down after we reclaim and only growth beyond where
+    // we last were is new excess
+    const quint64 target = memoryTarget();
+    const quint64 mark = qMax(target, m_excessMark);
+    m_excessMark = qMax(target, m_memoryUsage);
+#if defined(DEBUG_GOVERNOR)
+    qDebug() << "memory excess:" << (m_memoryUsage > mark ? m_memoryUsage - mark : 0);
+#endif
+    return m_memoryUsage > mark ? m_memoryUsage - mark : 0;
+}
@@ -0,0 +1,70 @@
+/*
+  This file is part of Allie Chess.
+  Copyright (C) 2018, 2019 Adam Treat
+
+  Allie Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Allie Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Allie Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+*/
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+#include <QString>
+
+// Reads the cpu and memory limits of the cgroup (v1 or v2) we are running in so that
+// we can size ourselves to the container rather than to the host
+class Governor {
+public:
+    static Governor *globalInstance();
+
+    // Reads the cgroup files relative to this path rather than "/" which is useful for testing
+    void setRootPath(const QString &path);
+
+    // Re-reads the limits and usage if enough time has passed, returns true if it did
+    bool update(bool force = false);
+
+    int cpuCount() const;
+    bool hasMemoryLimit() const { return m_memoryLimit > 0; }
+    quint64 memoryLimit() const { return m_memoryLimit; }
+    // The working set, ie, usage without the reclaimable page cache
+    quint64 memoryUsage() const { return m_memoryUsage; }
+
+    // The working set we should stay under to keep clear of the limit
+    quint64 memoryTarget() const;
+
+    // The bytes the working set has grown past the target since the last time we asked
+    quint64 takeExcess();
+
+private:
+    Governor();
+    ~Governor();
+    void findCgroupPaths();
+    void readCpuLimit();
+    void readMemory();
+    QString m_rootPath;
+    QString m_unifiedPath;
+    QString m_cpuPath;
+    QString m_memoryPath;
+    float m_cpuQuota;
+    quint64 m_memoryLimit;
+    quint64 m_memoryUsage;
+    quint64 m_excessMark;
+    QElapsedTimer m_lastUpdate;
+    friend class MyGovernor;
+};
+
+#endif // GOVERNOR_H
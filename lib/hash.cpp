@@ -22,39 +22,42 @@
 
 #include <QtMath>
 
+#include "governor.h"
 #include "node.h"
-#include "neural/nn_policy.h"
 #include "options.h"
 
 //#define DEBUG_HASH
 // increasing by one cuts number of entries by half
 #define MAX_POTENTIALS_COUNT 159
 
-struct HashPValue {
+struct HashPotential {
     float pValue = -2.0f;
-    qint32 index = -1;
+    quint32 move = 0;
 };
 
-quint64 pValueToHash(const HashPValue &hashPValue)
+quint64 potentialToHash(const HashPotential &hashPotential)
 {
-    Q_ASSERT(sizeof(HashPValue) == 8);
+    Q_ASSERT(sizeof(HashPotential) == 8);
     quint32 pValue;
-    memcpy(&pValue, &hashPValue.pValue, sizeof(hashPValue.pValue));
-    return quint64(pValue) << 32 | quint64(hashPValue.index);
+    memcpy(&pValue, &hashPotential.pValue, sizeof(hashPotential.pValue));
+    return quint64(pValue) << 32 | quint64(hashPotential.move);
 }
 
-HashPValue pValueFromHash(quint64 hash)
+HashPotential potentialFromHash(quint64 hash)
 {
-    HashPValue hashPValue;
+    HashPotential hashPotential;
     quint32 pValue = quint32((hash >> 32) & 0xFFFFFFFF);
-    memcpy(&hashPValue.pValue, &pValue, sizeof(pValue));
-    hashPValue.index = quint16(hash & 0xFFFFFFFF);
-    return hashPValue;
+    memcpy(&hashPotential.pValue, &pValue, sizeof(pValue));
+    hashPotential.move = quint32(hash & 0xFFFFFFFF);
+    return hashPotential;
 }
 
+// Holds the full expansion of a node, ie, the legal moves along with their priors so that
+// a hit can rebuild the potentials without going through the move generator
 struct HashEntry {
     float qValue = -2.0f;
-    quint64 potentialValues[MAX_POTENTIALS_COUNT];
+    quint16 potentialsCount = 0;
+    quint64 potentials[MAX_POTENTIALS_COUNT];
 };
 
 class MyHash : public Hash { };
@@ -65,25 +68,26 @@ Hash* Hash::globalInstance()
 }
 
 Hash::Hash()
-    : m_cache(nullptr)
+    : m_cache(nullptr),
+    m_size(0)
 {
-    Q_ASSERT(sizeof(HashPValue) == 8);
+    Q_ASSERT(sizeof(HashPotential) == 8);
 
 #if !defined(QT_NO_DEBUG)
-    HashPValue pValue;
-    pValue.pValue = 42.42f;
-    pValue.index = 42;
-
-    quint64 hash = pValueToHash(pValue);
-    HashPValue newPValue = pValueFromHash(hash);
-    bool pValsMatch = qFuzzyCompare(pValue.pValue, newPValue.pValue);
-    bool indexesMatch = pValue.index == newPValue.index;
-    if (!pValsMatch || !indexesMatch) {
-        qDebug() << "pVals:" << pValue.pValue << "," << newPValue.pValue;
-        qDebug() << "indexes:" << pValue.index << "," << newPValue.index;
+    HashPotential potential;
+    potential.pValue = 42.42f;
+    potential.move = 0x07FFFFFF; // all of the move bits
+
+    quint64 hash = potentialToHash(potential);
+    HashPotential newPotential = potentialFromHash(hash);
+    bool pValsMatch = qFuzzyCompare(potential.pValue, newPotential.pValue);
+    bool movesMatch = potential.move == newPotential.move;
+    if (!pValsMatch || !movesMatch) {
+        qDebug() << "pVals:" << potential.pValue << "," << newPotential.pValue;
+        qDebug() << "moves:" << potential.move << "," << newPotential.move;
     }
     Q_ASSERT(pValsMatch);
-    Q_ASSERT(indexesMatch);
+    Q_ASSERT(movesMatch);
 #endif
 }
 
@@ -104,8 +108,15 @@ quint64 largestPowerofTwoLessThan(quint64 n)
 void Hash::reset()
 {
     quint64 bytes = Options::globalInstance()->option("Hash").value().toUInt() * quint64(1024) * quint64(1024);
+
+    // Never let the hash take more than half of a container's memory as the tree needs the rest
+    const Governor *governor = Governor::globalInstance();
+    if (governor->hasMemoryLimit())
+        bytes = qMin(bytes, governor->memoryLimit() / 2);
+
     quint64 maxSize = bytes / sizeof(HashEntry);
     quint64 size = largestPowerofTwoLessThan(maxSize);
+    m_size = size;
     if (!m_cache || quint64(m_cache->totalCost()) != size) {
         delete m_cache;
         m_cache = new QCache<quint64, HashEntry>(int(size));
@@ -114,9 +125,35 @@ void Hash::reset()
 #endif
     }
 
+    // Take back anything we gave up under memory pressure
+    m_cache->setMaxCost(int(size));
     clear();
 }
 
+quint64 Hash::bytes() const
+{
+    if (!m_cache)
+        return 0;
+    return quint64(m_cache->count()) * sizeof(HashEntry);
+}
+
+void Hash::setMaxBytes(quint64 bytes)
+{
+    if (!m_cache)
+        return;
+
+    // We can give back memory and grow again once it frees up, but never beyond our reset size
+    const int size = int(qMin(m_size, bytes / sizeof(HashEntry)));
+    if (size == m_cache->maxCost())
+        return;
+
+    // QCache drops the least recently used entries to fit a smaller cost
+    m_cache->setMaxCost(size);
+#if defined(DEBUG_HASH)
+    qDebug() << "Hash resized to" << size;
+#endif
+}
+
 void Hash::clear()
 {
     if (m_cache)
@@ -131,27 +168,41 @@ bool Hash::contains(const Node *node) const
     return m_cache->contains(node->game().hash());
 }
 
+bool isPlausibleMove(const Game &game, const Move &move)
+{
+    // The moves of an entry are not generated for this position so make sure a zobrist collision
+    // can't sneak illegal moves into the tree: we need our own piece on the start square and
+    // can't have one on the end square
+    const Chess::Army army = game.activeArmy();
+    const int start = move.start().data();
+    const int end = move.end().data();
+    return move.isValid()
+        && game.hasPieceAt(start, army)
+        && game.hasPieceTypeAt(start, move.piece())
+        && !game.hasPieceAt(end, army);
+}
+
 bool fillOutNodeFromEntry(Node *node, const HashEntry &entry)
 {
     Q_ASSERT(!qFuzzyCompare(entry.qValue, -2.0f));
     Q_ASSERT(!node->hasRawQValue());
-    node->setRawQValue(entry.qValue);
-    Q_ASSERT((node->hasPotentials()) || node->isCheckMate() || node->isStaleMate());
-    if (!node->hasPotentials())
-        return true;
-
-    QHash<qint32, float> pVals;
-    for (int i = 0; i < MAX_POTENTIALS_COUNT; ++i) {
-        HashPValue pVal = pValueFromHash(entry.potentialValues[i]);
-        if (pVal.index != -1)
-            pVals.insert(pVal.index, pVal.pValue);
+    Q_ASSERT(!node->hasPotentials());
+    Q_ASSERT(entry.potentialsCount);
+
+    // Check all the moves before touching the node so a bad entry is just a miss
+    const Game game = node->game();
+    for (int i = 0; i < entry.potentialsCount; ++i) {
+        const HashPotential potential = potentialFromHash(entry.potentials[i]);
+        if (!isPlausibleMove(game, Move(potential.move)))
+            return false;
     }
-    Q_ASSERT(!pVals.isEmpty());
-    for (PotentialNode *potential : node->potentials()) {
-        Q_ASSERT(!potential->hasPValue());
-        const float pValue = pVals.value(moveToNNIndex(potential->move()));
-        Q_ASSERT(!qFuzzyCompare(pValue, -2.0f));
-        potential->setPValue(pValue);
+
+    node->setRawQValue(entry.qValue);
+
+    for (int i = 0; i < entry.potentialsCount; ++i) {
+        const HashPotential potential = potentialFromHash(entry.potentials[i]);
+        Q_ASSERT(!qFuzzyCompare(potential.pValue, -2.0f));
+        node->restorePotential(Move(potential.move), potential.pValue);
     }
 
     return true;
@@ -159,8 +210,7 @@ bool fillOutNodeFromEntry(Node *node, const HashEntry &entry)
 
 bool Hash::fillOut(Node *node) const
 {
-    Q_ASSERT(m_cache);
-    if (!m_cache)
+    if (!m_cache || !m_cache->maxCost())
         return false;
 
     HashEntry *entry = m_cache->object(node->game().hash());
@@ -175,26 +225,27 @@ void Hash::insert(const Node *node)
     if (!m_cache || !m_cache->maxCost())
         return;
 
-    if (node->potentials().count() > MAX_POTENTIALS_COUNT)
+    const QVector<PotentialNode*> po = node->potentials();
+    if (po.isEmpty())
+        return; // Nothing to expand from
+
+    if (po.count() > MAX_POTENTIALS_COUNT)
         return; // Too many potentials to cache!
 
     HashEntry *entry = new HashEntry;
     entry->qValue = node->rawQValue();
+    entry->potentialsCount = quint16(po.count());
     Q_ASSERT(!qFuzzyCompare(entry->qValue, -2.0f));
 
-    const QVector<PotentialNode*> po = node->potentials();
     for (int i = 0; i < po.count(); ++i) {
         PotentialNode *potential = po.at(i);
-        HashPValue pValue;
-        pValue.pValue = potential->pValue();
+        HashPotential hashPotential;
+        hashPotential.pValue = potential->pValue();
         Q_ASSERT(!qFuzzyCompare(potential->pValue(), -2.0f));
-        pValue.index = moveToNNIndex(potential->move());
-        entry->potentialValues[i] = pValueToHash(pValue);
+        hashPotential.move = potential->move().data();
+        entry->potentials[i] = potentialToHash(hashPotential);
     }
 
-    for (int i = po.count(); i < MAX_POTENTIALS_COUNT; ++i)
-        entry->potentialValues[i] = pValueToHash(HashPValue());
-
     m_cache->insert(node->game().hash(), entry, 1);
 }
 
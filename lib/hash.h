@@ -31,6 +31,8 @@ public:
     static Hash *globalInstance();
 
     void reset();
+    quint64 bytes() const;
+    void setMaxBytes(quint64 bytes);
     bool contains(const Node *node) const;
     bool fillOut(Node *node) const;
     void insert(const Node *node);
@@ -42,6 +44,7 @@ private:
     ~Hash();
     void clear();
     QCache<quint64, HashEntry> *m_cache;
+    quint64 m_size;
     friend class MyHash;
 };
 
@@ -36,6 +36,7 @@ HEADERS += \
     $$PWD/chess.h \
     $$PWD/clock.h \
     $$PWD/game.h \
+    $$PWD/governor.h \
     $$PWD/hash.h \
     $$PWD/history.h \
     $$PWD/move.h \
@@ -44,6 +45,7 @@ HEADERS += \
     $$PWD/node.h \
     $$PWD/notation.h \
     $$PWD/options.h \
+    $$PWD/pgn.h \
     $$PWD/piece.h \
     $$PWD/search.h \
     $$PWD/searchengine.h \
@@ -73,6 +75,7 @@ SOURCES += \
     $$PWD/bitboard.cpp \
     $$PWD/clock.cpp \
     $$PWD/game.cpp \
+    $$PWD/governor.cpp \
     $$PWD/hash.cpp \
     $$PWD/history.cpp \
     $$PWD/move.cpp \
@@ -81,6 +84,7 @@ SOURCES += \
     $$PWD/node.cpp \
     $$PWD/notation.cpp \
     $$PWD/options.cpp \
+    $$PWD/pgn.cpp \
     $$PWD/piece.cpp \
     $$PWD/search.cpp \
     $$PWD/searchengine.cpp \
@@ -30,6 +30,7 @@
 class Move {
 public:
     Move() : m_data(0) { }
+    explicit Move(quint32 data) : m_data(data) { }
 
     Square start() const;
     void setStart(const Square &start);
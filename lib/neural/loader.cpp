@@ -54,59 +54,44 @@ namespace lczero {
 namespace {
 const std::uint32_t kWeightMagic = 0x1c0;
 
-std::string DecompressGzip(const std::string& filename) {
-  const int kStartingSize = 8 * 1024 * 1024;  // 8M
-  std::string buffer;
-  buffer.resize(kStartingSize);
-  int bytes_read = 0;
-
-  // Read whole file into a buffer.
-  gzFile file = gzopen(filename.c_str(), "rb");
-#ifndef DISABLE_FOR_ALLIE
-  if (!file) throw Exception("Cannot read weights from " + filename);
-#else
-  if (!file) qDebug() << "Cannot read weights from " << QString::fromStdString(filename);
-#endif
-  while (true) {
-    int sz = gzread(file, &buffer[bytes_read], buffer.size() - bytes_read);
-    if (sz < 0) {
-      int errnum;
-#ifndef DISABLE_FOR_ALLIE
-      throw Exception(gzerror(file, &errnum));
-#else
-      qDebug() << "Cannot unzip file" << gzerror(file, &errnum);
-#endif
-    }
-    if (sz == static_cast<int>(buffer.size()) - bytes_read) {
-      bytes_read = buffer.size();
-      buffer.resize(buffer.size() * 2);
-    } else {
-      bytes_read += sz;
-      buffer.resize(bytes_read);
-      break;
-    }
+// Feeds gzread() straight into protobuf so the net is inflated in fixed size
+// chunks while it is parsed, rather than into a whole file buffer first.
+class GzipCopyingInputStream
+    : public google::protobuf::io::CopyingInputStream {
+ public:
+  explicit GzipCopyingInputStream(gzFile file) : file_(file) {}
+  int Read(void* buffer, int size) override {
+    return gzread(file_, buffer, static_cast<unsigned>(size));
   }
-  gzclose(file);
 
-  return buffer;
-}
+ private:
+  gzFile file_;
+};
 
-WeightsFile ParseWeightsProto(const std::string& buffer) {
+WeightsFile ParseWeightsProto(gzFile file) {
+  const int kBlockSize = 1024 * 1024;  // 1M
   WeightsFile net;
   using namespace google::protobuf::io;
   using nf = pblczero::NetworkFormat;
 
-  ArrayInputStream raw_input_stream(buffer.data(), buffer.size());
+  GzipCopyingInputStream gzip_stream(file);
+  CopyingInputStreamAdaptor raw_input_stream(&gzip_stream, kBlockSize);
   CodedInputStream input_stream(&raw_input_stream);
   // Set protobuf limit to 2GB, print warning at 500MB.
   input_stream.SetTotalBytesLimit(2000 * 1000000, 500 * 1000000);
 
-  if (!net.ParseFromCodedStream(&input_stream))
+  if (!net.ParseFromCodedStream(&input_stream)) {
+    int errnum = Z_OK;
+    const char* error = gzerror(file, &errnum);
 #ifndef DISABLE_FOR_ALLIE
+    if (errnum != Z_OK && errnum != Z_STREAM_END) throw Exception(error);
     throw Exception("Invalid weight file: parse error.");
 #else
+    if (errnum != Z_OK && errnum != Z_STREAM_END)
+      qDebug() << "Cannot unzip file" << error;
     qDebug() << "Invalid weight file: parse error.";
 #endif
+  }
 
   if (net.magic() != kWeightMagic)
 #ifndef DISABLE_FOR_ALLIE
@@ -170,31 +155,60 @@ WeightsFile ParseWeightsProto(const std::string& buffer) {
 }  // namespace
 
 WeightsFile LoadWeightsFromFile(const std::string& filename) {
-  FloatVectors vecs;
-  auto buffer = DecompressGzip(filename);
-
-  if (buffer.size() < 2)
+  const int kGzipBufferSize = 256 * 1024;  // 256K
+  gzFile file = gzopen(filename.c_str(), "rb");
 #ifndef DISABLE_FOR_ALLIE
+  if (!file) throw Exception("Cannot read weights from " + filename);
+#else
+  if (!file) {
+    qDebug() << "Cannot read weights from " << QString::fromStdString(filename);
+    return {};
+  }
+#endif
+  gzbuffer(file, kGzipBufferSize);
+
+  // Peek at the header to reject old formats, then rewind and stream the
+  // whole file into the protobuf parser.
+  char header[2];
+  const int sz = gzread(file, header, sizeof(header));
+  bool valid = true;
+  if (sz < 2) {
+#ifndef DISABLE_FOR_ALLIE
+    gzclose(file);
     throw Exception("Invalid weight file: too small.");
 #else
     qDebug() << "Invalid weight file: too small.";
+    valid = false;
 #endif
-  else if (buffer[0] == '1' && buffer[1] == '\n')
+  } else if (header[0] == '1' && header[1] == '\n') {
 #ifndef DISABLE_FOR_ALLIE
+    gzclose(file);
     throw Exception("Invalid weight file: no longer supported.");
 #else
     qDebug() << "Invalid weight file: no longer supported.";
+    valid = false;
 #endif
-  else if (buffer[0] == '2' && buffer[1] == '\n')
+  } else if (header[0] == '2' && header[1] == '\n') {
 #ifndef DISABLE_FOR_ALLIE
+    gzclose(file);
     throw Exception(
         "Text format weights files are no longer supported. Use a command line "
         "tool to convert it to the new format.");
 #else
     qDebug() << "Text format weights files are no longer supported. Use a command line "
         "tool to convert it to the new format.";
+    valid = false;
 #endif
-  return ParseWeightsProto(buffer);
+  }
+
+  if (!valid || gzrewind(file) != 0) {
+    gzclose(file);
+    return {};
+  }
+
+  auto net = ParseWeightsProto(file);
+  gzclose(file);
+  return net;
 }
 
 std::string DiscoverWeightsFile() {
@@ -20,12 +20,14 @@
 
 #include <cmath>
 #include <algorithm>
+#include <thread>
 
 #include "allie_shim.h"
 
 #ifndef DISABLE_FOR_ALLIE
 #include "utils/weights_adapter.h"
 #else
+#include "governor.h"
 #include "weights_adapter.h"
 #endif
 
@@ -55,9 +57,29 @@ LegacyWeights::LegacyWeights(const pblczero::Weights& weights)
       ip1_val_b(LayerAdapter(weights.ip1_val_b()).as_vector()),
       ip2_val_w(LayerAdapter(weights.ip2_val_w()).as_vector()),
       ip2_val_b(LayerAdapter(weights.ip2_val_b()).as_vector()) {
-  for (const auto& res : weights.residual()) {
-    residual.emplace_back(res);
+  // The residual tower is nearly all of the net, so dequantize its blocks in
+  // parallel with each worker taking every n-th block.
+  const int blocks = weights.residual_size();
+#ifndef DISABLE_FOR_ALLIE
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+#else
+  // Stay within the cpu quota of the container we are running in
+  const int cores = Governor::globalInstance()->cpuCount();
+#endif
+  const int workers = std::max(1, std::min(blocks, cores));
+  std::vector<std::vector<Residual>> partial(workers);
+  std::vector<std::thread> threads;
+  for (int w = 0; w < workers; ++w) {
+    threads.emplace_back([&weights, &partial, blocks, workers, w]() {
+      for (int i = w; i < blocks; i += workers)
+        partial[w].emplace_back(weights.residual(i));
+    });
   }
+  for (auto& t : threads) t.join();
+
+  residual.reserve(blocks);
+  for (int i = 0; i < blocks; ++i)
+    residual.push_back(std::move(partial[i % workers][i / workers]));
 }
 
 LegacyWeights::SEunit::SEunit(const pblczero::Weights::SEunit& se)
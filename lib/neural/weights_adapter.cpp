@@ -27,6 +27,10 @@
 
 #include "allie_shim.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #ifndef DISABLE_FOR_ALLIE
 #include "src/utils/weights_adapter.h"
 #else
@@ -46,7 +50,28 @@ LayerAdapter::LayerAdapter(const pblczero::Weights_Layer& layer)
       range_(layer.max_val() - min_) {}
 
 std::vector<float> LayerAdapter::as_vector() const {
-  return std::vector<float>(begin(), end());
+  std::vector<float> result(size_);
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Dequantize eight values at a time using the same operations as
+  // ExtractValue() so results match the scalar path.
+  const __m128 scale = _mm_set1_ps(static_cast<float>(0xffff));
+  const __m128 range = _mm_set1_ps(range_);
+  const __m128 min = _mm_set1_ps(min_);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= size_; i += 8) {
+    const __m128i raw =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + i));
+    const __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero));
+    const __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zero));
+    _mm_storeu_ps(&result[i],
+                  _mm_add_ps(_mm_mul_ps(_mm_div_ps(lo, scale), range), min));
+    _mm_storeu_ps(&result[i + 4],
+                  _mm_add_ps(_mm_mul_ps(_mm_div_ps(hi, scale), range), min));
+  }
+#endif
+  for (; i < size_; ++i) result[i] = Iterator::ExtractValue(data_ + i, this);
+  return result;
 }
 float LayerAdapter::Iterator::operator*() const {
   return ExtractValue(data_, adapter_);
@@ -21,6 +21,7 @@
 #include "nn.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QGlobalStatic>
 
@@ -36,6 +37,8 @@
 using namespace Chess;
 using namespace lczero;
 
+//#define DEBUG_LOAD
+
 const int s_moveHistory = 8;
 const int s_planesPerPos = 13;
 const int s_planeBase = s_planesPerPos * s_moveHistory;
@@ -162,9 +165,17 @@ Network *NeuralNet::createNewNetwork(int id, bool useFP16) const
 
 void NeuralNet::reset()
 {
+#if defined(DEBUG_LOAD)
+    QElapsedTimer timer;
+    timer.start();
+#endif
+
     if (!m_weightsValid) {
         s_weights = LoadWeightsFromFile(DiscoverWeightsFile());
         m_weightsValid = true;
+#if defined(DEBUG_LOAD)
+        qDebug() << "Loaded weights in" << timer.elapsed() << "ms";
+#endif
     }
 
     const int numberOfGPUCores = Options::globalInstance()->option("GPUCores").value().toInt();
@@ -178,6 +189,10 @@ void NeuralNet::reset()
     m_availableNetworks.clear();
     for (int i = 0; i < numberOfGPUCores; ++i)
         m_availableNetworks.append(createNewNetwork(i, m_usingFP16));
+
+#if defined(DEBUG_LOAD)
+    qDebug() << "Created networks in" << timer.elapsed() << "ms";
+#endif
 }
 
 void NeuralNet::setWeights(const QString &pathToWeights)
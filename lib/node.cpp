@@ -48,7 +48,8 @@ Node::Node(Node *parent, const Game &game)
     m_policySum(0),
     m_uCoeff(-2.0f),
     m_isExact(false),
-    m_isPrefetch(false)
+    m_isPrefetch(false),
+    m_isCollapsed(false)
 {
     m_scoringOrScored.clear();
 }
@@ -187,6 +188,21 @@ void Node::setRawQValue(float qValue)
 
 void Node::backPropagateValue(float v)
 {
+    // A forced node that was collapsed into its only reply was never evaluated by the NN so
+    // it takes on the value found at the end of the chain
+    if (m_isCollapsed && !hasQValue()) {
+        if (m_parent)
+            m_parent->m_policySum += pValue();
+        m_rawQValue = v;
+        m_qValue = v;
+        incrementVisited();
+#if defined(DEBUG_FETCHANDBP)
+        qDebug() << "bp forced " << toString() << " v:" << v;
+#endif
+        return;
+    }
+
+    Q_ASSERT(hasQValue());
     const float currentQValue = hasQValue() ? m_qValue : 0.0f;
     const float n = qMax(quint32(1), m_visited);
     m_qValue = (n * currentQValue + v) / (n + 1.f);
@@ -513,25 +529,21 @@ bool Node::checkAndGenerateDTZ(int *dtz)
     return true;
 }
 
-bool Node::generatePotentials()
+bool Node::checkAndGenerateExact(bool *isTbHit)
 {
-    Q_ASSERT(!hasPotentials());
-    if (hasPotentials())
-        return false;
-
     // Check if this is drawn by rules
     if (Q_UNLIKELY(m_game.halfMoveClock() >= 100)) {
         m_rawQValue = 0.0f;
         m_isExact = true;
-        return false;
+        return true;
     } else if (Q_UNLIKELY(m_game.isDeadPosition())) {
         m_rawQValue = 0.0f;
         m_isExact = true;
-        return false;
+        return true;
     } else if (Q_UNLIKELY(isThreeFold())) {
         m_rawQValue = 0.0f;
         m_isExact = true;
-        return false;
+        return true;
     }
 
     const TB::Probe result = isRootNode() ? TB::NotFound : TB::globalInstance()->probe(m_game);
@@ -541,18 +553,42 @@ bool Node::generatePotentials()
     case TB::Win:
         m_rawQValue = 1.0f;
         m_isExact = true;
+        *isTbHit = true;
         return true;
     case TB::Loss:
         m_rawQValue = -1.0f;
         m_isExact = true;
+        *isTbHit = true;
         return true;
     case TB::Draw:
         m_rawQValue = 0.0f;
         m_isExact = true;
+        *isTbHit = true;
         return true;
     }
 
-    // Otherwise try and generate potential moves
+    return false;
+}
+
+bool Node::generatePotentials()
+{
+    Q_ASSERT(!hasPotentials());
+    if (hasPotentials())
+        return false;
+
+    bool isTbHit = false;
+    if (checkAndGenerateExact(&isTbHit))
+        return isTbHit;
+
+    generateLegalPotentials();
+    return false;
+}
+
+void Node::generateLegalPotentials()
+{
+    Q_ASSERT(!hasPotentials());
+
+    // Try and generate potential moves
     m_game.pseudoLegalMoves(this);
 
     // Override the NN in case of checkmates or stalemates
@@ -569,7 +605,6 @@ bool Node::generatePotentials()
         }
         Q_ASSERT(isCheckMate() || isStaleMate());
     }
-    return false;
 }
 
 void Node::generatePotential(const Move &move)
@@ -585,6 +620,15 @@ void Node::generatePotential(const Move &move)
     m_potentials.append(new PotentialNode(move));
 }
 
+void Node::restorePotential(const Move &move, float pValue)
+{
+    // Only for moves that are already known to be legal such as those restored from the hash
+    Q_ASSERT(move.isValid());
+    PotentialNode *potential = new PotentialNode(move);
+    potential->setPValue(pValue);
+    m_potentials.append(potential);
+}
+
 Node *Node::generateChild(PotentialNode *potential)
 {
     Q_ASSERT(potential);
@@ -599,6 +643,51 @@ Node *Node::generateChild(PotentialNode *potential)
     return child;
 }
 
+bool Node::graftChild(Node *child)
+{
+    // Puts an already searched root in place of the potential that leads to it keeping all
+    // of its visits, which means we have to be expanded and evaluated already
+    Q_ASSERT(child->isRootNode());
+    Q_ASSERT(hasQValue());
+    for (PotentialNode *potential : m_potentials) {
+        Game g = m_game;
+        if (!g.makeMove(potential->move()) || !g.isSamePosition(child->m_game))
+            continue;
+
+        child->m_parent = this;
+        child->setPValue(potential->pValue());
+        m_children.append(child);
+        m_potentials.removeAll(potential);
+        delete potential;
+
+        // Fold in the visits of the child as though they had been backpropagated one by one
+        if (child->m_visited) {
+            m_policySum += child->pValue();
+            const float n = m_visited;
+            const float childN = child->m_visited;
+            m_qValue = (n * m_qValue - childN * child->m_qValue) / (n + childN);
+            m_visited += child->m_visited;
+            m_uCoeff = -2.0f;
+        }
+        return true;
+    }
+    return false;
+}
+
+Node *Node::generateForcedChild()
+{
+    // With only one legal reply the policy has nothing to say so we can expand it right away
+    // and mark it as the node being played out in our place
+    Q_ASSERT(isForced());
+    m_isCollapsed = true;
+    PotentialNode *potential = m_potentials.first();
+    potential->setPValue(1.0f);
+    Node *child = generateChild(potential);
+    child->setScoringOrScored();
+    ++child->m_virtualLoss;
+    return child;
+}
+
 QString Node::toString(Chess::NotationType notation) const
 {
     QString string;
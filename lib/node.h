@@ -106,6 +106,7 @@ public:
     bool isRootNode() const;
     void setAsRootNode();
     Node *parent() const { return m_parent; }
+    quint32 visited() const { return m_visited; }
 
     // children and potentials
     inline bool hasChildren() const { return !m_children.isEmpty(); }
@@ -162,9 +163,16 @@ public:
     // children and potential generation
     bool hasNoisyChildren() const;
     bool checkAndGenerateDTZ(int *dtz);
+    bool checkAndGenerateExact(bool *isTbHit);
     bool generatePotentials();
+    void generateLegalPotentials();
     void generatePotential(const Move &move);
+    void restorePotential(const Move &move, float pValue);
     Node *generateChild(PotentialNode *potential);
+    bool graftChild(Node *child);
+    bool isForced() const { return !hasChildren() && m_potentials.count() == 1; }
+    bool isCollapsed() const { return m_isCollapsed; }
+    Node *generateForcedChild();
 
     // flag saying we are in midst of scoring
     bool setScoringOrScored()
@@ -186,6 +194,7 @@ private:
     mutable float m_uCoeff;
     bool m_isExact: 1;
     bool m_isPrefetch: 1;
+    bool m_isCollapsed: 1;
     std::atomic_flag m_scoringOrScored;
     template<Traversal t>
     friend class TreeIterator;
@@ -0,0 +1,277 @@
+/*
+  This file is part of Allie Chess.
+  Copyright (C) 2018, 2019 Adam Treat
+
+  Allie Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Allie Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Allie Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+*/
+
+#include "pgn.h"
+
+#include <QFile>
+#include <QObject>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTextStream>
+
+#include "node.h"
+#include "notation.h"
+
+using namespace Chess;
+
+static bool isResult(const QString &token)
+{
+    return token == QLatin1String("1-0")
+        || token == QLatin1String("0-1")
+        || token == QLatin1String("1/2-1/2")
+        || token == QLatin1String("*");
+}
+
+static QStringList tokenizeMoveText(const QString &moveText)
+{
+    // Strip comments and variations leaving only the mainline
+    QString mainLine;
+    int variationDepth = 0;
+    bool inBraceComment = false;
+    bool inLineComment = false;
+    for (QChar c : moveText) {
+        if (inLineComment) {
+            if (c == '\n')
+                inLineComment = false;
+            continue;
+        }
+        if (inBraceComment) {
+            if (c == '}')
+                inBraceComment = false;
+            continue;
+        }
+        if (c == '{') {
+            inBraceComment = true;
+        } else if (c == ';') {
+            inLineComment = true;
+        } else if (c == '(') {
+            ++variationDepth;
+        } else if (c == ')') {
+            variationDepth = qMax(0, variationDepth - 1);
+        } else if (!variationDepth) {
+            mainLine += c;
+        }
+    }
+
+    static const QRegularExpression moveNumber(QLatin1String("^\\d+\\.+"));
+    QStringList tokens;
+    const QStringList words = mainLine.split(QRegularExpression(QLatin1String("\\s+")), QString::SkipEmptyParts);
+    for (QString word : words) {
+        word.remove(moveNumber); // 1. or 1... possibly attached to the move
+        if (word.isEmpty() || word.startsWith('$'))
+            continue; // NAG
+        tokens << word;
+    }
+    return tokens;
+}
+
+static void finishGame(PgnGame *pgn, const QString &moveText, bool *ok, QString *err)
+{
+    pgn->fen = pgn->tags.value(QLatin1String("FEN"));
+    Game game(pgn->fen);
+
+    const QStringList tokens = tokenizeMoveText(moveText);
+    for (const QString &token : tokens) {
+        if (isResult(token)) {
+            pgn->result = token;
+            break;
+        }
+
+        bool success = true;
+        QString error;
+        Move mv = Pgn::sanToMove(token, game, &success, &error);
+        if (!success || !game.makeMove(mv)) {
+            if (ok) *ok = false;
+            if (err) *err = QString("%1 at %2 in game %3").arg(error).arg(token)
+                .arg(pgn->tags.value(QLatin1String("Event")));
+            break;
+        }
+        pgn->moves.append(Notation::moveToString(mv, Chess::Computer));
+    }
+}
+
+QVector<PgnGame> Pgn::readFile(const QString &fileName, bool *ok, QString *err)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if (ok) *ok = false;
+        if (err) *err = QObject::tr("Could not open pgn file %1").arg(fileName);
+        return QVector<PgnGame>();
+    }
+
+    QTextStream stream(&file);
+    return parse(stream.readAll(), ok, err);
+}
+
+QVector<PgnGame> Pgn::parse(const QString &text, bool *ok, QString *err)
+{
+    if (ok)
+        *ok = true;
+    if (err)
+        *err = QString();
+
+    static const QRegularExpression tagPair(QLatin1String("^\\[\\s*(\\w+)\\s+\"(.*)\"\\s*\\]$"));
+
+    QVector<PgnGame> games;
+    PgnGame current;
+    QString moveText;
+    bool inMoveText = false;
+
+    const QStringList lines = text.split('\n');
+    for (const QString &l : lines) {
+        const QString line = l.trimmed();
+        if (line.startsWith('[') && !line.startsWith(QLatin1String("[%"))) {
+            // A tag after movetext starts the next game
+            if (inMoveText) {
+                finishGame(&current, moveText, ok, err);
+                games.append(current);
+                current = PgnGame();
+                moveText.clear();
+                inMoveText = false;
+            }
+
+            QRegularExpressionMatch match = tagPair.match(line);
+            if (match.hasMatch())
+                current.tags.insert(match.captured(1), match.captured(2));
+            continue;
+        }
+
+        if (line.isEmpty() && !inMoveText)
+            continue;
+
+        inMoveText = true;
+        moveText += line + '\n';
+    }
+
+    if (inMoveText || !current.tags.isEmpty()) {
+        finishGame(&current, moveText, ok, err);
+        games.append(current);
+    }
+
+    return games;
+}
+
+Move Pgn::sanToMove(const QString &san, const Game &game, bool *ok, QString *err)
+{
+    if (ok)
+        *ok = true;
+    if (err)
+        *err = QString();
+
+    // Strip check, checkmate and annotation glyphs along with the capture and promotion markers
+    QString str = san;
+    while (!str.isEmpty() && QString("+#!?").contains(str.at(str.length() - 1)))
+        str.chop(1);
+    str.remove('x');
+    str.remove('=');
+
+    bool isCastle = false;
+    Chess::Castle castleSide = KingSide;
+    if (str == QLatin1String("O-O") || str == QLatin1String("0-0")) {
+        isCastle = true;
+        castleSide = KingSide;
+    } else if (str == QLatin1String("O-O-O") || str == QLatin1String("0-0-0")) {
+        isCastle = true;
+        castleSide = QueenSide;
+    }
+
+    PieceType piece = Pawn;
+    PieceType promotion = Unknown;
+    int fromFile = -1;
+    int fromRank = -1;
+    Square end;
+    if (!isCastle) {
+        if (!str.isEmpty() && QString("KQRBN").contains(str.at(0))) {
+            piece = Notation::charToPiece(str.at(0));
+            str.remove(0, 1);
+        }
+
+        if (piece == Pawn && !str.isEmpty() && QString("QRBN").contains(str.at(str.length() - 1))) {
+            promotion = Notation::charToPiece(str.at(str.length() - 1));
+            str.chop(1);
+        }
+
+        bool squareOk = str.length() >= 2;
+        if (squareOk)
+            end = Notation::stringToSquare(str.right(2), Chess::Standard, &squareOk);
+        if (!squareOk) {
+            if (ok) *ok = false;
+            if (err) *err = QObject::tr("String for SAN move has no valid destination.");
+            return Move();
+        }
+
+        // Anything left over is disambiguation
+        const QString disambiguation = str.left(str.length() - 2);
+        for (QChar c : disambiguation) {
+            if (c >= 'a' && c <= 'h') {
+                fromFile = c.toLatin1() - 'a';
+            } else if (c >= '1' && c <= '8') {
+                fromRank = c.toLatin1() - '1';
+            } else {
+                if (ok) *ok = false;
+                if (err) *err = QObject::tr("String for SAN move has invalid disambiguation.");
+                return Move();
+            }
+        }
+    }
+
+    // Match against the legal moves of the position
+    Node node(nullptr, game);
+    game.pseudoLegalMoves(&node);
+
+    Move result;
+    int matches = 0;
+    for (PotentialNode *potential : node.potentials()) {
+        const Move mv = potential->move();
+        if (isCastle) {
+            if (mv.isCastle() && mv.castleSide() == castleSide) {
+                result = mv;
+                ++matches;
+            }
+            continue;
+        }
+
+        if (mv.piece() != piece || mv.end() != end || mv.promotion() != promotion)
+            continue;
+        if (fromFile != -1 && mv.start().file() != fromFile)
+            continue;
+        if (fromRank != -1 && mv.start().rank() != fromRank)
+            continue;
+
+        result = mv;
+        ++matches;
+    }
+
+    if (matches != 1) {
+        if (ok) *ok = false;
+        if (err) *err = matches ? QObject::tr("SAN move is ambiguous.") : QObject::tr("SAN move is illegal.");
+        return Move();
+    }
+
+    return result;
+}
+
+Pgn::Pgn()
+{
+}
+
+Pgn::~Pgn()
+{
+}
@@ -0,0 +1,51 @@
+/*
+  This file is part of Allie Chess.
+  Copyright (C) 2018, 2019 Adam Treat
+
+  Allie Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Allie Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Allie Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+*/
+
+#ifndef PGN_H
+#define PGN_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "game.h"
+#include "move.h"
+
+struct PgnGame {
+    QHash<QString, QString> tags;
+    QString fen;
+    QVector<QString> moves; // in computer notation, ie, e2e4
+    QString result;
+};
+
+class Pgn {
+public:
+    static QVector<PgnGame> readFile(const QString &fileName, bool *ok = 0, QString *err = 0);
+    static QVector<PgnGame> parse(const QString &text, bool *ok = 0, QString *err = 0);
+
+    // Resolves a SAN move against the legal moves of the game
+    static Move sanToMove(const QString &san, const Game &game, bool *ok = 0, QString *err = 0);
+
+private:
+    Pgn();
+    ~Pgn();
+};
+
+#endif // PGN_H
@@ -46,6 +46,8 @@ QDebug operator<<(QDebug debug, const Search &search)
         debug << "movetime: " << search.movetime;
     if (search.infinite)
         debug << "infinite: " << search.infinite;
+    if (search.ponder)
+        debug << "ponder: " << search.ponder;
 
     return debug.space();
 }
@@ -38,6 +38,7 @@ struct Search {
     qint64 mate = -1;
     qint64 movetime = -1;
     bool infinite = false;
+    bool ponder = false;
     Game game;
 };
 
@@ -60,6 +61,7 @@ struct WorkerInfo {
     int numberOfBatches = 0;
     int nodesCacheHits = 0;
     int nodesTBHits = 0;
+    int nodesForced = 0; // NN evaluations saved by collapsing forced moves
     QString threadId;
 };
 
@@ -79,6 +81,7 @@ struct SearchInfo {
     QString ponderMove;
     bool isResume = false;
     bool isDTZ = false;
+    bool isForced = false;
     WorkerInfo workerInfo;
 };
 
@@ -26,6 +26,7 @@
 #include <QFuture>
 
 #include "game.h"
+#include "governor.h"
 #include "hash.h"
 #include "move.h"
 #include "node.h"
@@ -162,8 +163,9 @@ bool SearchWorker::fillOutTree()
     return didWork;
 }
 
-bool SearchWorker::handlePlayout(Node *playout, int depth, WorkerInfo *info)
+bool SearchWorker::handlePlayout(Node **playoutNode, int depth, WorkerInfo *info)
 {
+    Node *playout = *playoutNode;
     info->nodesSearched += 1;
     info->nodesSearchedTotal += playout->m_virtualLoss;
     info->sumDepths += depth * int(playout->m_virtualLoss);
@@ -199,35 +201,74 @@ bool SearchWorker::handlePlayout(Node *playout, int depth, WorkerInfo *info)
         return false;
     }
 
-    // Generate potential moves of the node if possible
-    m_tree->mutex.lock();
-    const bool isTbHit = playout->generatePotentials();
-    if (isTbHit)
-        info->nodesTBHits += 1;
-    m_tree->mutex.unlock();
+    forever {
+        // Check if this is drawn by rules or found in the TB
+        m_tree->mutex.lock();
+        bool isTbHit = false;
+        playout->checkAndGenerateExact(&isTbHit);
+        if (isTbHit)
+            info->nodesTBHits += 1;
+        m_tree->mutex.unlock();
 
-    // If we *newly* discovered a playout that can override the NN (checkmate/stalemate/drawish...),
-    // then let's just set the value and propagate
-    if (playout->isExact()) {
+        // If we *newly* discovered a playout that can override the NN (drawish or TB hit...),
+        // then let's just set the value and propagate
+        if (playout->isExact()) {
 #if defined(DEBUG_PLAYOUT_MCTS)
-        qDebug() << "adding exact playout 2" << playout->toString();
+            qDebug() << "adding exact playout 2" << playout->toString();
 #endif
-        info->nodesCacheHits += 1;
-        QMutexLocker locker(&m_tree->mutex);
-        playout->setQValueAndPropagate();
-        return false;
-    }
+            info->nodesCacheHits += 1;
+            QMutexLocker locker(&m_tree->mutex);
+            playout->setQValueAndPropagate();
+            return false;
+        }
 
-    // If this playout is in cache, retrieve the values and back propagate and continue
-    if (Hash::globalInstance()->contains(playout)) {
+        // If this playout is in cache, build the potentials straight from the entry without
+        // touching the move generator and then back propagate and continue
+        {
+            QMutexLocker locker(&m_tree->mutex);
+            if (Hash::globalInstance()->fillOut(playout)) {
 #if defined(DEBUG_PLAYOUT_MCTS)
-        qDebug() << "found cached playout" << playout->toString();
+                qDebug() << "found cached playout" << playout->toString();
 #endif
-        info->nodesCacheHits += 1;
-        QMutexLocker locker(&m_tree->mutex);
-        Hash::globalInstance()->fillOut(playout);
-        playout->setQValueAndPropagate();
-        return false;
+                info->nodesCacheHits += 1;
+                playout->setQValueAndPropagate();
+                return false;
+            }
+        }
+
+        // Generate potential moves of the node
+        m_tree->mutex.lock();
+        playout->generateLegalPotentials();
+        m_tree->mutex.unlock();
+
+        // If we *newly* discovered a checkmate or stalemate, then let's just set the value and propagate
+        if (playout->isExact()) {
+#if defined(DEBUG_PLAYOUT_MCTS)
+            qDebug() << "adding exact playout 3" << playout->toString();
+#endif
+            info->nodesCacheHits += 1;
+            QMutexLocker locker(&m_tree->mutex);
+            playout->setQValueAndPropagate();
+            return false;
+        }
+
+        if (!playout->isForced() || depth >= MAX_DEPTH)
+            break;
+
+        // With a single legal reply the value of this node is just the negation of its child so
+        // rather than spend a NN evaluation on it we play out the forced move in its place
+        m_tree->mutex.lock();
+        playout = playout->generateForcedChild();
+        m_tree->mutex.unlock();
+        *playoutNode = playout;
+
+#if defined(DEBUG_PLAYOUT_MCTS)
+        qDebug() << "collapsing forced playout" << playout->toString();
+#endif
+        ++depth;
+        info->maxDepth = qMax(info->maxDepth, depth);
+        info->nodesCreated += 1;
+        info->nodesForced += 1;
     }
 
     return true; // Otherwise we should fetch from NN
@@ -256,7 +297,7 @@ QVector<Node*> SearchWorker::playoutNodesMCTS(int size, bool *didWork, WorkerInf
 
         *didWork = true;
 
-        bool shouldFetchFromNN = handlePlayout(playout, depth, info);
+        bool shouldFetchFromNN = handlePlayout(&playout, depth, info);
         if (!shouldFetchFromNN) {
             ++exactOrCached;
             continue;
@@ -328,6 +369,7 @@ WorkerThread::~WorkerThread()
     worker->stopSearch(); // thread safe using atomic
     thread.quit();
     thread.wait();
+    QThreadPool::globalInstance()->releaseThread();
 }
 
 SearchEngine::SearchEngine(QObject *parent)
@@ -360,7 +402,7 @@ void SearchEngine::reset()
     const int numberOfGPUCores = Options::globalInstance()->option("GPUCores").value().toInt();
     const int numberOfThreads = Options::globalInstance()->option("Threads").value().toInt();
     const int numberOfSearchThreads = qMax(1, numberOfGPUCores * numberOfThreads);
-    if (m_workers.count() != numberOfThreads) {
+    if (m_workers.count() != numberOfSearchThreads) {
         qDeleteAll(m_workers);
         m_workers.clear();
         for (int i = 0; i < numberOfSearchThreads; ++i) {
@@ -384,6 +426,40 @@ void SearchEngine::reset()
     }
 }
 
+bool SearchEngine::reclaimMemory(quint64 bytes)
+{
+    // Give up hash entries as the tree is what we're searching, the hash is not thread safe so
+    // it is guarded by the tree mutex
+    QMutexLocker locker(&m_tree->mutex);
+    Hash *hash = Hash::globalInstance();
+    const quint64 hashBytes = hash->bytes();
+    hash->setMaxBytes(hashBytes > bytes ? hashBytes - bytes : 0);
+    return hashBytes >= bytes;
+}
+
+void SearchEngine::fitToMemory(quint64 usage, quint64 target)
+{
+    // Nothing accounts for the tree we would resume, so if we are at the target already it is
+    // pruned and the next search starts afresh in the memory it leaves behind
+    QMutexLocker locker(&m_mutex);
+    if (usage >= target) {
+        std::function<void()> gc = std::bind(&SearchEngine::gcNode, m_tree->root);
+        QtConcurrent::run(gc);
+        m_tree->root = nullptr;
+    }
+
+    // The hash can grow back into whatever room is left
+    QMutexLocker treeLocker(&m_tree->mutex);
+    Hash *hash = Hash::globalInstance();
+    hash->setMaxBytes(hash->bytes() + (usage < target ? target - usage : 0));
+}
+
+int SearchEngine::maximumWorkers() const
+{
+    // Don't run more search threads than the cpu quota of our container allows
+    return qMin(m_workers.count(), Governor::globalInstance()->cpuCount());
+}
+
 void SearchEngine::gcNode(Node *node)
 {
     if (!node) // safe to delete nullptr
@@ -410,6 +486,22 @@ bool SearchEngine::tryResumeSearch(const Search &s)
         return false;
 
     const QVector<Node*> ch = m_tree->root->children();
+
+    // When analyzing consecutive plies of a game the new position is a child of the old root
+    for (Node *child : ch) {
+        if (child->m_game.isSamePosition(s.game) && !child->isExact()) {
+            child->setAsRootNode();
+            std::function<void()> gc = std::bind(&SearchEngine::gcNode, m_tree->root);
+            QtConcurrent::run(gc);
+            m_tree->root = child;
+            return true;
+        }
+    }
+
+    // When analyzing a game backwards the new position is the parent of the old root
+    if (tryGraftSearch(s))
+        return true;
+
     for (Node *child : ch) {
         const QVector<Node*> gch = child->children();
         for (Node *grandChild : gch) {
@@ -425,6 +517,63 @@ bool SearchEngine::tryResumeSearch(const Search &s)
     return false;
 }
 
+bool SearchEngine::tryGraftSearch(const Search &s)
+{
+    // Cheaply check that the move leading to the old root can be played in the new position
+    Node *oldRoot = m_tree->root;
+    Game g = s.game;
+    if (!oldRoot->m_visited || !oldRoot->m_game.lastMove().isValid() || !g.makeMove(oldRoot->m_game.lastMove())
+        || !g.isSamePosition(oldRoot->m_game))
+        return false;
+
+    // The old root can only take the place of a potential so expand and evaluate the new root
+    // right away
+    Node *root = new Node(nullptr, s.game);
+    bool isTbHit = false;
+    if (root->checkAndGenerateExact(&isTbHit)) {
+        delete root;
+        return false;
+    }
+
+    evaluateRoot(root);
+
+    if (!root->graftChild(oldRoot)) {
+        delete root;
+        return false;
+    }
+
+    m_tree->root = root;
+    return true;
+}
+
+bool SearchEngine::evaluateRoot(Node *root)
+{
+    // Expands and evaluates a root outside of the workers, preferably from the hash, and
+    // returns whether it took an evaluation of the network
+    m_tree->mutex.lock();
+    const bool isCached = Hash::globalInstance()->fillOut(root);
+    m_tree->mutex.unlock();
+
+    if (!isCached) {
+        root->generateLegalPotentials();
+        Q_ASSERT(!root->isExact());
+
+        Computation computation;
+        computation.addPositionToEvaluate(root);
+        computation.evaluate();
+        root->setRawQValue(-computation.qVal(0));
+        computation.setPVals(0, root);
+
+        m_tree->mutex.lock();
+        Hash::globalInstance()->insert(root);
+        m_tree->mutex.unlock();
+    }
+
+    root->setScoringOrScored();
+    root->setQValueAndPropagate();
+    return !isCached;
+}
+
 QString mateDistanceOrScore(float score, int pvDepth) {
     QString s = QString("cp %0").arg(scoreToCP(score));
     if (score > 1.0f || qFuzzyCompare(score, 1.0f))
@@ -434,6 +583,24 @@ QString mateDistanceOrScore(float score, int pvDepth) {
     return s;
 }
 
+static bool isTimedSearch(const Search &s)
+{
+    // Searches for analysis, with a fixed target or pondering should not be cut short as
+    // a ponder search must not send a bestmove before ponderhit or stop
+    return !s.infinite && !s.ponder && s.depth == -1 && s.nodes == -1 && s.mate == -1;
+}
+
+static bool isForcedMove(const Game &game, Move *move)
+{
+    Node node(nullptr, game);
+    game.pseudoLegalMoves(&node);
+    if (node.potentials().count() != 1)
+        return false;
+
+    *move = node.potentials().first()->move();
+    return true;
+}
+
 void SearchEngine::startSearch(const Search &s)
 {
     QMutexLocker locker(&m_mutex);
@@ -453,6 +620,7 @@ void SearchEngine::startSearch(const Search &s)
     if (m_tree->root) {
         // Check the DTZ and if found just use it and stop the search
         int dtz = 0;
+        Move forcedMove;
         if (m_tree->root->checkAndGenerateDTZ(&dtz)) {
             // We found a dtz move
             const int depth = dtz;
@@ -471,6 +639,37 @@ void SearchEngine::startSearch(const Search &s)
             m_currentInfo.score = mateDistanceOrScore(-dtzNode->qValue(), depth + 1);
             emit sendInfo(m_currentInfo, false /*isPartial*/);
             return; // We are all done
+        } else if (isTimedSearch(s) && isForcedMove(s.game, &forcedMove)) {
+            // There is nothing to think about so don't waste the clock
+            m_currentInfo.isForced = true;
+            m_currentInfo.depth = 1;
+            m_currentInfo.seldepth = 1;
+            m_currentInfo.nodes = 1;
+            m_currentInfo.workerInfo.nodesSearched += 1;
+            m_currentInfo.workerInfo.nodesSearchedTotal += 1;
+            m_currentInfo.workerInfo.sumDepths = 1;
+            m_currentInfo.workerInfo.maxDepth = 1;
+            m_currentInfo.bestMove = Notation::moveToString(forcedMove, Chess::Computer);
+            m_currentInfo.pv = m_currentInfo.bestMove;
+
+            // Score it by what we know of the root from the resumed tree, failing that the hash
+            // or a single evaluation, the forced move taking on the negation of its value
+            if (!m_tree->root->hasQValue() && evaluateRoot(m_tree->root))
+                m_currentInfo.workerInfo.nodesEvaluated += 1;
+            m_currentInfo.score = mateDistanceOrScore(-m_tree->root->qValue(), 1);
+
+            // If we've already searched the forced move, then use what we know of the reply to
+            // give a score and something to ponder on
+            Node *forced = m_tree->root->bestChild(Node::MCTS);
+            if (forced && forced->hasQValue()) {
+                int pvDepth = 0;
+                m_currentInfo.pv = m_tree->root->principalVariation(&pvDepth, Node::MCTS);
+                m_currentInfo.score = mateDistanceOrScore(forced->qValue(), pvDepth);
+                if (Node *ponder = forced->bestChild(Node::MCTS))
+                    m_currentInfo.ponderMove = Notation::moveToString(ponder->m_game.lastMove(), Chess::Computer);
+            }
+            emit sendInfo(m_currentInfo, false /*isPartial*/);
+            return; // We are all done
         } else if (Node *best = m_tree->root->bestChild(Node::MCTS)) {
             // If we have a bestmove candidate, set it now
             m_currentInfo.isResume = true;
@@ -481,6 +680,11 @@ void SearchEngine::startSearch(const Search &s)
         }
     }
 
+    // Every worker reserves a thread from the global pool whether or not it is started so the
+    // pool needs room for all of those plus the threads that fetch batches from the network
+    const int cpuCount = Governor::globalInstance()->cpuCount();
+    QThreadPool::globalInstance()->setMaxThreadCount(m_workers.count() + cpuCount);
+
     Q_ASSERT(!m_workers.isEmpty());
     m_workers.first()->startWorker(m_tree);
     ++m_startedWorkers;
@@ -532,6 +736,7 @@ void SearchEngine::receivedWorkerInfo(const WorkerInfo &info)
     m_currentInfo.workerInfo.numberOfBatches += info.numberOfBatches;
     m_currentInfo.workerInfo.nodesTBHits += info.nodesTBHits;
     m_currentInfo.workerInfo.nodesCacheHits += info.nodesCacheHits;
+    m_currentInfo.workerInfo.nodesForced += info.nodesForced;
 
     // Update our depth info
     const int newDepth = m_currentInfo.workerInfo.sumDepths / qMax(1, m_currentInfo.workerInfo.nodesSearched);
@@ -605,7 +810,7 @@ void SearchEngine::workerReachedMaxBatchSize()
         return;
 
     // Try and start another worker if we have any
-    if (m_startedWorkers < m_workers.count()) {
+    if (m_startedWorkers < maximumWorkers()) {
 #if defined(DEBUG_EVAL)
         qDebug() << "Starting worker" << m_startedWorkers;
 #endif
@@ -65,7 +65,7 @@ private:
     bool fillOutTree();
 
     // Playout methods
-    bool handlePlayout(Node *node, int depth, WorkerInfo *info);
+    bool handlePlayout(Node **node, int depth, WorkerInfo *info);
 
     // MCTS related methods
     QVector<Node*> playoutNodesMCTS(int size, bool *didWork, WorkerInfo *info);
@@ -100,6 +100,15 @@ public:
 
     SearchInfo currentInfo() const { return m_currentInfo; }
 
+    // The root the next search would resume from, only to be looked at between searches
+    const Node *root() const { return m_tree->root; }
+
+    // Shrinks the hash by the given bytes during a search, returns false if it isn't that big
+    bool reclaimMemory(quint64 bytes);
+    // Between searches prunes the tree if the working set is at the target, otherwise lets the
+    // hash grow into the room that is left
+    void fitToMemory(quint64 usage, quint64 target);
+
 public Q_SLOTS:
     void reset();
     void startSearch(const Search &search);
@@ -118,6 +127,9 @@ private:
     static void gcNode(Node *node);
     void resetSearch(const Search &search);
     bool tryResumeSearch(const Search &search);
+    bool tryGraftSearch(const Search &search);
+    bool evaluateRoot(Node *root);
+    int maximumWorkers() const;
 
     Tree *m_tree;
     int m_startedWorkers;
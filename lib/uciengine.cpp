@@ -28,16 +28,19 @@
 #include <QTextStream>
 #include <QTimer>
 
+#include <algorithm>
 #include <iostream>
 
 #include "chess.h"
 #include "clock.h"
 #include "game.h"
+#include "governor.h"
 #include "hash.h"
 #include "history.h"
 #include "nn.h"
 #include "notation.h"
 #include "options.h"
+#include "pgn.h"
 #include "searchengine.h"
 #include "tb.h"
 
@@ -255,7 +258,9 @@ UciEngine::UciEngine(QObject *parent, const QString &debugFile)
     m_depthTargeted(-1),
     m_nodesTargeted(-1),
     m_clock(new Clock(this)),
-    m_ioHandler(nullptr)
+    m_ioHandler(nullptr),
+    m_analysisNodes(-1),
+    m_isAnalyzing(false)
 {
     m_searchEngine = new SearchEngine(this);
     connect(m_searchEngine, &SearchEngine::sendInfo, this, &UciEngine::sendInfo);
@@ -337,6 +342,8 @@ void UciEngine::readyRead(const QString &line)
         }
         if (m_searchEngine)
             m_searchEngine->printTree(depth);
+    } else if (line.startsWith("analyzepgn")) {
+        analyzePgn(line);
     }
 }
 
@@ -426,6 +433,7 @@ void UciEngine::calculateRollingAverage(const SearchInfo &info)
     avgW.nodesCreated      = rollingAverage(avgW.nodesCreated, newW.nodesCreated, n);
     avgW.nodesTBHits       = rollingAverage(avgW.nodesTBHits, newW.nodesTBHits, n);
     avgW.nodesCacheHits    = rollingAverage(avgW.nodesCacheHits, newW.nodesCacheHits, n);
+    avgW.nodesForced       = rollingAverage(avgW.nodesForced, newW.nodesForced, n);
 }
 
 void UciEngine::sendBestMove(bool force)
@@ -456,6 +464,18 @@ void UciEngine::sendBestMove(bool force)
     if (Q_UNLIKELY(m_ioHandler))
         m_ioHandler->handleBestMove(m_lastInfo.bestMove);
 
+    if (m_isAnalyzing) {
+        sendAnalysis();
+        stopSearch(); // we block until the search has stopped
+
+        // Queue the next ply so that we are not starting a search from within this one
+        if (!m_analysisPlies.isEmpty())
+            QTimer::singleShot(0, this, &UciEngine::analyzeNextPly);
+        else
+            m_isAnalyzing = false;
+        return;
+    }
+
     QString out;
     QTextStream stream(&out);
     if (m_lastInfo.ponderMove.isEmpty())
@@ -468,6 +488,24 @@ void UciEngine::sendBestMove(bool force)
     stopSearch(); // we block until the search has stopped
 }
 
+void UciEngine::sendAnalysis()
+{
+    QString out;
+    QTextStream stream(&out);
+    stream << "info analysis"
+           << " game " << m_currentPly.game
+           << " ply " << m_currentPly.ply
+           << " played " << m_currentPly.played
+           << " bestmove " << m_lastInfo.bestMove
+           << " score " << m_lastInfo.score
+           << " nodes " << m_lastInfo.nodes
+           << " pv " << m_lastInfo.pv
+           << endl;
+    if (m_analysisPlies.isEmpty())
+        stream << "info analysis done" << endl;
+    output(out);
+}
+
 void UciEngine::sendInfo(const SearchInfo &info, bool isPartial)
 {
     // Check if this is an expired search
@@ -489,6 +527,17 @@ void UciEngine::sendInfo(const SearchInfo &info, bool isPartial)
         return;
     }
 
+    // Keep the working set under the target of the container we're running in, giving back
+    // hash first and then ending the search so that the tree can be pruned before the next one
+    Governor *governor = Governor::globalInstance();
+    if (governor->update() && governor->hasMemoryLimit()) {
+        const quint64 excess = governor->takeExcess();
+        if (excess && !m_searchEngine->reclaimMemory(excess) && !m_lastInfo.bestMove.isEmpty()) {
+            sendBestMove(true /*force*/);
+            return;
+        }
+    }
+
     // Otherwise begin updating info
     qint64 msecs = m_clock->elapsed();
     m_lastInfo.time = msecs;
@@ -496,7 +545,8 @@ void UciEngine::sendInfo(const SearchInfo &info, bool isPartial)
 
     const bool targetReached = (m_depthTargeted != -1 && m_lastInfo.depth >= m_depthTargeted)
         || (m_nodesTargeted != -1 && m_lastInfo.nodes >= m_nodesTargeted)
-        || info.isDTZ;
+        || info.isDTZ
+        || info.isForced;
 
     if (!targetReached && (isPartial && (msecs - m_timeAtLastProgress) < 2500))
         return;
@@ -534,6 +584,7 @@ void UciEngine::sendInfo(const SearchInfo &info, bool isPartial)
                << " nodesEvaluated " << m_lastInfo.workerInfo.nodesEvaluated
                << " nodesCreated " << m_lastInfo.workerInfo.nodesCreated
                << " nodesCacheHits " << m_lastInfo.workerInfo.nodesCacheHits
+               << " nodesForced " << m_lastInfo.workerInfo.nodesForced
                << endl;
     }
 
@@ -576,6 +627,7 @@ void UciEngine::sendAverages()
            << " nodesCreated " << m_averageInfo.workerInfo.nodesCreated
            << " nodesTBHits " << m_averageInfo.workerInfo.nodesTBHits
            << " nodesCacheHits " << m_averageInfo.workerInfo.nodesCacheHits
+           << " nodesForced " << m_averageInfo.workerInfo.nodesForced
            << endl;
     output(out);
 }
@@ -618,6 +670,7 @@ void UciEngine::ponderHit()
 void UciEngine::stop()
 {
     //qDebug() << "stop";
+    m_analysisPlies.clear();
     sendBestMove(true /*force*/);
 }
 
@@ -704,6 +757,7 @@ void UciEngine::parseGo(const QString &line)
     search.mate = getNextIntAfterSearch(goLine, "mate");
     search.movetime = getNextIntAfterSearch(goLine, "movetime");
     search.infinite = goLine.contains("infinite");
+    search.ponder = goLine.contains("ponder");
     search.game = History::globalInstance()->currentGame();
 
     go(search);
@@ -729,6 +783,73 @@ void UciEngine::parseOption(const QString &line)
     Options::globalInstance()->setOption(name, value);
 }
 
+void UciEngine::analyzePgn(const QString &line)
+{
+    QList<QString> analyzeLine = line.split(' ');
+    if (analyzeLine.count() < 2)
+        return;
+
+    bool ok = true;
+    QString err;
+    const QVector<PgnGame> games = Pgn::readFile(analyzeLine.at(1), &ok, &err);
+    if (!ok)
+        output(QString("info string %1\n").arg(err));
+
+    const int nodes = getNextIntAfterSearch(analyzeLine, "nodes");
+    const bool backward = analyzeLine.contains("backward");
+    m_analysisNodes = nodes != -1 ? nodes : 10000;
+    m_analysisPlies.clear();
+
+    for (int i = 0; i < games.count(); ++i) {
+        const PgnGame &pgn = games.at(i);
+        QVector<AnalysisPly> plies;
+        for (int j = 0; j < pgn.moves.count(); ++j) {
+            AnalysisPly ply;
+            ply.game = i + 1;
+            ply.ply = j + 1;
+            ply.fen = pgn.fen.isEmpty() ? QLatin1String("startpos") : pgn.fen;
+            ply.moves = pgn.moves.mid(0, j);
+            ply.played = pgn.moves.at(j);
+            plies.append(ply);
+        }
+
+        // Annotators work backwards from the end so that the search of the positions that
+        // actually arise later in the game is kept, the old root being grafted under the new one
+        if (backward)
+            std::reverse(plies.begin(), plies.end());
+
+        for (const AnalysisPly &ply : plies)
+            m_analysisPlies.enqueue(ply);
+    }
+
+    if (m_analysisPlies.isEmpty()) {
+        output(QLatin1String("info analysis done\n"));
+        return;
+    }
+
+    uciNewGame();
+    m_isAnalyzing = true;
+    analyzeNextPly();
+}
+
+void UciEngine::analyzeNextPly()
+{
+    if (m_analysisPlies.isEmpty()) {
+        m_isAnalyzing = false;
+        return;
+    }
+
+    m_currentPly = m_analysisPlies.dequeue();
+    setPosition(m_currentPly.fen, m_currentPly.moves);
+
+    // Deliberately no uciNewGame so that the tree and hash from the neighbouring ply are reused
+    Search search;
+    search.nodes = m_analysisNodes;
+    search.infinite = true;
+    search.game = History::globalInstance()->currentGame();
+    go(search);
+}
+
 void UciEngine::go(const Search& s)
 {
     //qDebug() << "go";
@@ -750,6 +871,13 @@ void UciEngine::go(const Search& s)
     m_nodesTargeted = s.nodes;
     m_lastInfo = SearchInfo();
 
+    // Pick up any change in the cpu quota and make the tree we'd resume and the hash fit in
+    // the memory we have
+    Governor *governor = Governor::globalInstance();
+    governor->update(true /*force*/);
+    if (governor->hasMemoryLimit())
+        m_searchEngine->fitToMemory(governor->memoryUsage(), governor->memoryTarget());
+
     startSearch(s);
 }
 
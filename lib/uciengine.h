@@ -104,6 +104,14 @@ public:
     virtual void handleBestMove(const QString &bestMove);
 };
 
+struct AnalysisPly {
+    int game = 0;
+    int ply = 0;
+    QString fen;
+    QVector<QString> moves;
+    QString played;
+};
+
 class UciEngine : public QObject {
     Q_OBJECT
 public:
@@ -126,6 +134,7 @@ public Q_SLOTS:
     void ponderHit();
     void stop();
     void quit();
+    void analyzeNextPly();
     void readyRead(const QString &line);
     void installIOHandler(IOHandler *io) { m_ioHandler = io; }
 
@@ -140,6 +149,8 @@ private:
     void setPosition(const QString &position, const QVector<QString> &moves);
     void parseGo(const QString &move);
     void parseOption(const QString &option);
+    void analyzePgn(const QString &line);
+    void sendAnalysis();
     void go(const Search &search);
 
     void input(const QString &in);
@@ -159,6 +170,10 @@ private:
     qint64 m_nodesTargeted;
     Clock *m_clock;
     IOHandler *m_ioHandler;
+    QQueue<AnalysisPly> m_analysisPlies;
+    AnalysisPly m_currentPly;
+    qint64 m_analysisNodes;
+    bool m_isAnalyzing;
 };
 
 #endif
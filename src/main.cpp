@@ -24,6 +24,7 @@
 #include <QDir>
 #include <stdio.h>
 
+#include "governor.h"
 #include "hash.h"
 #include "movegen.h"
 #include "nn.h"
@@ -79,6 +80,7 @@ int main(int argc, char *argv[])
 
     Zobrist::globalInstance();
     Movegen::globalInstance();
+    Governor::globalInstance();
 
     UciEngine engine(&a, debugFile);
     engine.run();
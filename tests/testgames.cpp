@@ -21,11 +21,15 @@
 #include <QtCore>
 
 #include "game.h"
+#include "governor.h"
 #include "hash.h"
 #include "history.h"
+#include "neural/weights_adapter.h"
 #include "nn.h"
 #include "node.h"
 #include "notation.h"
+#include "options.h"
+#include "pgn.h"
 #include "searchengine.h"
 #include "testgames.h"
 #include "treeiterator.h"
@@ -422,13 +426,13 @@ void TestGames::testHashInsertAndRetrieve()
 
     // Create a new node with the same position
     Node *node2 = new Node(nullptr, game);
-    node2->generatePotentials();
-    QCOMPARE(node2->potentials().count(), 20);
+    QVERIFY(!node2->hasPotentials());
 
     QVERIFY(Hash::globalInstance()->contains(node2));
 
-    // Go to the Hash to fill out
-    Hash::globalInstance()->fillOut(node2);
+    // Go to the Hash to fill out which restores the potentials without generating moves
+    QVERIFY(Hash::globalInstance()->fillOut(node2));
+    QCOMPARE(node2->potentials().count(), 20);
 
     QCOMPARE(node1->potentials().count(), node2->potentials().count());
     QCOMPARE(node1->rawQValue(), node2->rawQValue());
@@ -442,3 +446,403 @@ void TestGames::testHashInsertAndRetrieve()
         QCOMPARE(potential1->pValue(), potential2->pValue());
     }
 }
+
+void TestGames::testPgnParse()
+{
+    const QString text = QLatin1String(
+        "[Event \"Test\"]\n"
+        "[Result \"1/2-1/2\"]\n"
+        "\n"
+        "1. d4 d5 2. Nf3 Nf6 {main line} 3. c4 e6 4. Nc3 Nbd7 (4... Be7 5. Bg5) 5. Bg5 $1 Be7!?\n"
+        "6. e3 O-O 1/2-1/2\n"
+        "\n"
+        "[Event \"Promotion\"]\n"
+        "[FEN \"8/P7/8/8/8/8/8/k6K w - - 0 1\"]\n"
+        "\n"
+        "1. a8=Q+ 1-0\n");
+
+    bool ok = false;
+    QString err;
+    QVector<PgnGame> games = Pgn::parse(text, &ok, &err);
+    QVERIFY2(ok, err.toLatin1().constData());
+    QCOMPARE(games.count(), 2);
+
+    const QString expected = QLatin1String("d2d4 d7d5 g1f3 g8f6 c2c4 e7e6 b1c3 b8d7 c1g5 f8e7 e2e3 e8g8");
+    QCOMPARE(games.at(0).moves.toList().join(' '), expected);
+    QCOMPARE(games.at(0).result, QLatin1String("1/2-1/2"));
+    QVERIFY(games.at(0).fen.isEmpty());
+
+    QCOMPARE(games.at(1).fen, QLatin1String("8/P7/8/8/8/8/8/k6K w - - 0 1"));
+    QCOMPARE(games.at(1).moves.toList().join(' '), QLatin1String("a7a8q"));
+    QCOMPARE(games.at(1).result, QLatin1String("1-0"));
+
+    // Illegal moves are rejected
+    Game g;
+    Pgn::sanToMove(QLatin1String("Nf3"), g, &ok);
+    QVERIFY(ok);
+    Pgn::sanToMove(QLatin1String("Ke2"), g, &ok);
+    QVERIFY(!ok);
+
+    // With knights on b1 and f3 both able to go to d2 the move has to be disambiguated
+    const QVector<QString> moves = { "d2d4", "d7d5", "g1f3", "g8f6" };
+    for (const QString &move : moves)
+        QVERIFY(g.makeMove(Notation::stringToMove(move, Chess::Computer)));
+    Pgn::sanToMove(QLatin1String("Nd2"), g, &ok, &err);
+    QVERIFY(!ok);
+    QCOMPARE(err, QObject::tr("SAN move is ambiguous."));
+    Move mv = Pgn::sanToMove(QLatin1String("Nbd2"), g, &ok);
+    QVERIFY(ok);
+    QCOMPARE(Notation::moveToString(mv, Chess::Computer), QLatin1String("b1d2"));
+    mv = Pgn::sanToMove(QLatin1String("Nfd2"), g, &ok);
+    QVERIFY(ok);
+    QCOMPARE(Notation::moveToString(mv, Chess::Computer), QLatin1String("f3d2"));
+}
+
+void TestGames::testLayerAdapter()
+{
+    // An odd length so that both the vectorized blocks and the scalar tail are exercised
+    const QVector<quint16> values = { 0, 0xffff, 1, 0x7fff, 0x8000, 12345, 54321, 0xfffe,
+        42, 999, 0x1234, 0xabcd, 0xfedc, 7, 0x4000, 0xc000, 31337, 2, 0x00ff };
+    QCOMPARE(values.count(), 19);
+
+    pblczero::Weights_Layer layer;
+    layer.set_min_val(-1.5f);
+    layer.set_max_val(2.25f);
+    layer.set_params(std::string(reinterpret_cast<const char*>(values.constData()),
+        size_t(values.count()) * sizeof(quint16)));
+
+    // The SSE2 path must give exactly the same floats as dequantizing one at a time
+    const lczero::LayerAdapter adapter(layer);
+    const std::vector<float> vector = adapter.as_vector();
+    QCOMPARE(adapter.size(), size_t(values.count()));
+    QCOMPARE(vector.size(), adapter.size());
+    for (size_t i = 0; i < vector.size(); ++i) {
+        QVERIFY2(vector[i] == adapter[i], QString("Mismatch at %1: %2 vs %3")
+            .arg(i).arg(double(vector[i]), 0, 'g', 9).arg(double(adapter[i]), 0, 'g', 9)
+            .toLatin1().constData());
+    }
+}
+
+static void searchNodes(SearchEngine *engine, const Search &search, int nodes)
+{
+    // Wait for the workers to report back so that we don't stop before they have started
+    QSignalSpy infoSpy(engine, &SearchEngine::sendInfo);
+    engine->startSearch(search);
+    while (engine->currentInfo().nodes < nodes && infoSpy.wait(10000)) {}
+    engine->stopSearch();
+}
+
+void TestGames::testResumeSearch()
+{
+    Hash::globalInstance()->reset();
+    NeuralNet::globalInstance()->reset();
+    SearchEngine engine(this);
+    engine.reset();
+
+    // Search a little after 1. e4
+    Game game;
+    QVERIFY(game.makeMove(Notation::stringToMove(QLatin1String("e2e4"), Chess::Computer)));
+    Search search;
+    search.game = game;
+    search.infinite = true;
+    searchNodes(&engine, search, 100);
+    QVERIFY(engine.currentInfo().nodes >= 100);
+
+    const Node *root = engine.root();
+    QVERIFY(root);
+    QVERIFY(root->game().isSamePosition(game));
+    const Node *child = nullptr;
+    for (const Node *c : root->children()) {
+        if (!child || c->visited() > child->visited())
+            child = c;
+    }
+    QVERIFY(child);
+    QVERIFY(child->visited() > 0);
+
+    // Going forward a ply the child becomes the root keeping its visits
+    quint32 childVisits = child->visited();
+    search.game = child->game();
+    searchNodes(&engine, search, 50);
+    QCOMPARE(engine.root(), child);
+    QVERIFY(child->isRootNode());
+    QVERIFY(child->visited() >= childVisits);
+
+    // Going back a ply the old root is grafted under a freshly expanded root
+    childVisits = child->visited();
+    search.game = game;
+    searchNodes(&engine, search, 50);
+    const Node *newRoot = engine.root();
+    QVERIFY(newRoot != child);
+    QVERIFY(newRoot->game().isSamePosition(game));
+    QVERIFY(child->parent() == newRoot);
+    QVERIFY(newRoot->children().contains(const_cast<Node*>(child)));
+    QVERIFY(child->hasPValue());
+    QVERIFY(child->visited() >= childVisits);
+    QVERIFY(newRoot->visited() > childVisits);
+}
+
+static QStringList runAnalysis(UciEngine *engine, const QString &command, bool *done)
+{
+    QSignalSpy outputSpy(engine, &UciEngine::sendOutput);
+    engine->readyRead(command);
+
+    // The plies are queued so keep the event loop going until we are told we're done
+    QStringList lines;
+    *done = false;
+    while (!*done && (!outputSpy.isEmpty() || outputSpy.wait(30000))) {
+        while (!outputSpy.isEmpty()) {
+            const QString out = outputSpy.takeFirst().at(0).toString();
+            for (const QString &line : out.split('\n', QString::SkipEmptyParts)) {
+                if (line == QLatin1String("info analysis done"))
+                    *done = true;
+                else if (line.startsWith(QLatin1String("info analysis ")))
+                    lines << line;
+            }
+        }
+    }
+    return lines;
+}
+
+void TestGames::testAnalyzePgn()
+{
+    QTemporaryFile pgnFile;
+    QVERIFY(pgnFile.open());
+    pgnFile.write("[Event \"Analysis\"]\n\n1. e4 e5 2. Nf3 *\n");
+    pgnFile.close();
+
+    const QStringList played = { "e2e4", "e7e5", "g1f3" };
+    for (bool backward : { false, true }) {
+        UciEngine engine(this, QString());
+        UCIIOHandler handler(this);
+        engine.installIOHandler(&handler);
+
+        bool done = false;
+        const QString command = QString("analyzepgn %1 nodes 100%2")
+            .arg(pgnFile.fileName()).arg(backward ? " backward" : "");
+        const QStringList lines = runAnalysis(&engine, command, &done);
+        QVERIFY(done);
+
+        // One line per ply in the order they were analyzed
+        QCOMPARE(lines.count(), played.count());
+        for (int i = 0; i < lines.count(); ++i) {
+            const int ply = backward ? played.count() - i : i + 1;
+            const QString expected = QString("info analysis game 1 ply %1 played %2 bestmove ")
+                .arg(ply).arg(played.at(ply - 1));
+            QVERIFY2(lines.at(i).startsWith(expected), lines.at(i).toLatin1().constData());
+        }
+    }
+}
+
+void TestGames::testForcedMove()
+{
+    // White is in check and Kh2 is the only legal move
+    const QLatin1String forcedFen = QLatin1String("7k/8/8/8/8/8/6P1/r6K w - - 0 1");
+
+    // A forced node expands its only reply without any help from the NN
+    Node *root = new Node(nullptr, Game(forcedFen));
+    root->generatePotentials();
+    QVERIFY(root->isForced());
+    Node *child = root->generateForcedChild();
+    QVERIFY(root->isCollapsed());
+    QCOMPARE(Notation::moveToString(child->game().lastMove(), Chess::Computer), QLatin1String("h1h2"));
+    QCOMPARE(child->pValue(), 1.0f);
+    QVERIFY(!root->hasPotentials());
+    QVERIFY(!root->isForced());
+
+    // And takes on the negated value of its reply when that is evaluated
+    child->setRawQValue(0.25f);
+    child->setQValueAndPropagate();
+    QCOMPARE(root->qValue(), -0.25f);
+    QCOMPARE(root->rawQValue(), -0.25f);
+    delete child;
+    delete root;
+
+    // The engine plays the forced move immediately rather than searching
+    UciEngine engine(this, QString());
+    UCIIOHandler handler(this);
+    engine.installIOHandler(&handler);
+
+    QSignalSpy bestMoveSpy(&handler, &UCIIOHandler::receivedBestMove);
+    engine.readyRead(QString("position fen %1").arg(forcedFen));
+    engine.readyRead(QLatin1String("go wtime 60000 btime 60000"));
+    const bool receivedSignal = bestMoveSpy.isEmpty() ? bestMoveSpy.wait() : true;
+    QVERIFY(receivedSignal);
+    QCOMPARE(handler.lastBestMove(), QLatin1String("h1h2"));
+    QVERIFY(handler.lastInfo().isForced);
+
+    // Scored by a single evaluation of the position as the tree knows nothing about it
+    QCOMPARE(handler.lastInfo().workerInfo.nodesEvaluated, 1);
+    Node *evaluated = new Node(nullptr, Game(forcedFen));
+    evaluated->generateLegalPotentials();
+    Computation computation;
+    computation.addPositionToEvaluate(evaluated);
+    computation.evaluate();
+    QCOMPARE(handler.lastInfo().score, QString("cp %1").arg(scoreToCP(computation.qVal(0))));
+    delete evaluated;
+
+    // Unless it is pondering where the bestmove has to wait for ponderhit or stop
+    handler.clear();
+    bestMoveSpy.clear();
+    engine.readyRead(QLatin1String("go ponder wtime 60000 btime 60000"));
+    QVERIFY(!bestMoveSpy.wait(500));
+    engine.readyRead(QLatin1String("stop"));
+    QVERIFY(!bestMoveSpy.isEmpty());
+    QCOMPARE(handler.lastBestMove(), QLatin1String("h1h2"));
+    QVERIFY(!handler.lastInfo().isForced);
+}
+
+static void writeCgroupFile(const QString &root, const QString &path, const QByteArray &contents)
+{
+    const QString fileName = root + path;
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(contents);
+}
+
+class BlockingTask : public QRunnable {
+public:
+    BlockingTask(QSemaphore *started, QSemaphore *release)
+        : m_started(started), m_release(release) {}
+    void run() override
+    {
+        m_started->release();
+        m_release->acquire();
+    }
+
+private:
+    QSemaphore *m_started;
+    QSemaphore *m_release;
+};
+
+void TestGames::testCappedSearch()
+{
+    // A container with a quota of two cpus, but asked for more search threads than that
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString root = dir.path();
+    writeCgroupFile(root, "/proc/self/cgroup", "0::/\n");
+    writeCgroupFile(root, "/sys/fs/cgroup/cpu.max", "200000 100000\n");
+    writeCgroupFile(root, "/sys/fs/cgroup/memory.max", "max\n");
+    Governor *governor = Governor::globalInstance();
+    governor->setRootPath(root);
+    Options::globalInstance()->setOption("Threads", "4");
+    const int cpus = governor->cpuCount();
+
+    {
+        UciEngine engine(this, QString());
+        UCIIOHandler handler(this);
+        engine.installIOHandler(&handler);
+
+        QSignalSpy bestMoveSpy(&handler, &UCIIOHandler::receivedBestMove);
+        engine.readyRead(QLatin1String("position startpos"));
+        engine.readyRead(QLatin1String("go nodes 400"));
+        const bool receivedSignal = bestMoveSpy.isEmpty() ? bestMoveSpy.wait(30000) : true;
+        if (!receivedSignal)
+            engine.readyRead(QLatin1String("stop"));
+        QVERIFY(receivedSignal);
+        QVERIFY(!handler.lastBestMove().isEmpty());
+
+        // All four workers hold on to their reserved threads, but there must still be room in
+        // the pool to evaluate as many batches at once as we have cpus
+        QThreadPool *pool = QThreadPool::globalInstance();
+        QSemaphore started;
+        QSemaphore release;
+        for (int i = 0; i < cpus; ++i)
+            pool->start(new BlockingTask(&started, &release));
+        const bool concurrent = started.tryAcquire(cpus, 10000);
+        release.release(cpus);
+        pool->waitForDone(10000);
+        QVERIFY(concurrent);
+    }
+
+    Options::globalInstance()->setOption("Threads", "1");
+    governor->setRootPath(QString());
+}
+
+void TestGames::testGovernor()
+{
+    Governor *governor = Governor::globalInstance();
+    const int cores = qMax(1, QThread::idealThreadCount());
+
+    // cgroup v2 without any limits
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString root = dir.path();
+        writeCgroupFile(root, "/proc/self/cgroup", "0::/\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/cpu.max", "max 100000\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.max", "max\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.current", "1000\n");
+        governor->setRootPath(root);
+        QCOMPARE(governor->cpuCount(), cores);
+        QVERIFY(!governor->hasMemoryLimit());
+    }
+
+    // cgroup v2 with a quota of one and a half cpus and a gigabyte of memory where the page
+    // cache does not count against us
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString root = dir.path();
+        writeCgroupFile(root, "/proc/self/cgroup", "0::/\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/cpu.max", "150000 100000\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.max", "1073741824\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.current", "900000000\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.stat", "anon 500000000\ninactive_file 400000000\n");
+        governor->setRootPath(root);
+        QCOMPARE(governor->cpuCount(), qMin(2, cores));
+        QVERIFY(governor->hasMemoryLimit());
+        QCOMPARE(governor->memoryLimit(), quint64(1073741824));
+        QCOMPARE(governor->memoryUsage(), quint64(500000000));
+
+        // Under the target there is nothing to reclaim
+        const quint64 target = quint64(1073741824 * 0.9);
+        QCOMPARE(governor->memoryTarget(), target);
+        QCOMPARE(governor->takeExcess(), quint64(0));
+
+        // Growing past the target is excess
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.current", "1400000000\n");
+        governor->update(true /*force*/);
+        QCOMPARE(governor->takeExcess(), quint64(1000000000) - target);
+
+        // But staying there after we've reclaimed it is not as the freed memory is reused
+        governor->update(true /*force*/);
+        QCOMPARE(governor->takeExcess(), quint64(0));
+
+        // Only further growth is
+        writeCgroupFile(root, "/sys/fs/cgroup/memory.current", "1500000000\n");
+        governor->update(true /*force*/);
+        QCOMPARE(governor->takeExcess(), quint64(100000000));
+    }
+
+    // Hybrid layout with the limits in the v1 controllers of a docker container
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString root = dir.path();
+        writeCgroupFile(root, "/proc/self/cgroup",
+            "12:memory:/docker/allie\n"
+            "4:cpu,cpuacct:/docker/allie\n"
+            "0::/docker/allie\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/unified/docker/allie/cpu.max", "50000 100000\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/cpu,cpuacct/docker/allie/cpu.cfs_quota_us", "-1\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/cpu,cpuacct/docker/allie/cpu.cfs_period_us", "100000\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory/docker/allie/memory.limit_in_bytes", "9223372036854771712\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory/docker/allie/memory.usage_in_bytes", "1000\n");
+        governor->setRootPath(root);
+        QCOMPARE(governor->cpuCount(), cores);
+        QVERIFY(!governor->hasMemoryLimit());
+
+        // Limits that change are picked up on the next update
+        writeCgroupFile(root, "/sys/fs/cgroup/cpu,cpuacct/docker/allie/cpu.cfs_quota_us", "200000\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory/docker/allie/memory.limit_in_bytes", "2147483648\n");
+        writeCgroupFile(root, "/sys/fs/cgroup/memory/docker/allie/memory.stat", "total_inactive_file 200\n");
+        governor->update(true /*force*/);
+        QCOMPARE(governor->cpuCount(), qMin(2, cores));
+        QCOMPARE(governor->memoryLimit(), quint64(2147483648));
+        QCOMPARE(governor->memoryUsage(), quint64(800));
+    }
+
+    governor->setRootPath(QString());
+}
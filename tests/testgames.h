@@ -78,6 +78,13 @@ private slots:
     void testMateWithKBBvK();
     void testMateWithKQQvK();
     void testHashInsertAndRetrieve();
+    void testPgnParse();
+    void testLayerAdapter();
+    void testResumeSearch();
+    void testAnalyzePgn();
+    void testForcedMove();
+    void testGovernor();
+    void testCappedSearch();
 
 private:
     void checkGame(const QString &fen, const QVector<QString> &mv);
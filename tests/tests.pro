@@ -18,6 +18,8 @@ CONFIG(release, debug|release) {
 DEFINES += QT_DEPRECATED_WARNINGS
 
 INCLUDEPATH += $$PWD/../lib
+# For the generated protobuf headers
+INCLUDEPATH += $$OUT_PWD/../lib
 
 HEADERS += \
     testgames.h